@@ -13,7 +13,9 @@ import threading
 import argparse
 import socket
 import datetime
-from typing import Literal, Mapping, Sequence
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from typing import Dict, List, Literal, Mapping, Optional, Sequence, Tuple
 import requests
 import sys
 
@@ -25,6 +27,200 @@ _prog_name = sys.argv[0].split("/")[-1]
 NtfyPriorityT = Literal["max", "high", "default", "low", "min"]
 
 
+class Histogram:
+    """A cumulative histogram, rendered in the Prometheus text format.
+
+    Not thread-safe on its own, guard it with the lock of the owning HeartbeatMetrics.
+    """
+
+    def __init__(self, buckets: Sequence[float]):
+        self.buckets = sorted(buckets)
+        self.counts = [0] * len(self.buckets)
+        self.count = 0
+        self.sum = 0.0
+
+    def observe(self, value: float) -> None:
+        for i, upper_bound in enumerate(self.buckets):
+            if value <= upper_bound:
+                self.counts[i] += 1
+        self.count += 1
+        self.sum += value
+
+    def render(self, name: str, labels: str = "") -> List[str]:
+        sep = "," if labels else ""
+        lines = [
+            f'{name}_bucket{{{labels}{sep}le="{upper_bound:g}"}} {count}'
+            for upper_bound, count in zip(self.buckets, self.counts)
+        ]
+        lines.append(f'{name}_bucket{{{labels}{sep}le="+Inf"}} {self.count}')
+        suffix = f"{{{labels}}}" if labels else ""
+        lines.append(f"{name}_sum{suffix} {self.sum}")
+        lines.append(f"{name}_count{suffix} {self.count}")
+        return lines
+
+
+class HeartbeatMetrics:
+    """Metrics of the heartbeat listener, exported in the Prometheus text format.
+
+    Recording a metric only takes the internal lock for a few dict/list updates so that it's cheap
+    enough to do from the UDP receive path. Rendering takes a snapshot under the lock and does the
+    formatting outside of it, so scrapes never hold up heartbeat processing.
+    """
+
+    # the client sends a heartbeat every 30 minutes by default - resolve the area around that
+    INTER_ARRIVAL_BUCKETS_S = (60, 300, 900, 1500, 1700, 1800, 1900, 2100, 2700, 3600, 7200, 14400)
+    NTFY_LATENCY_BUCKETS_S = (0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30)
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.start_time = time.monotonic()
+
+        # per-device (i.e., per source address) metrics
+        self.last_seen: Dict[str, float] = {}
+        self.heartbeats_received: Dict[str, int] = {}
+        self.inter_arrival: Dict[str, Histogram] = {}
+
+        self.datagrams_received = 0
+        self.missed_beats = 0
+        self.restored_beats = 0
+
+        self.ntfy_latency = Histogram(self.NTFY_LATENCY_BUCKETS_S)
+        self.ntfy_failures = 0
+
+    def observe_heartbeat(self, device: str) -> None:
+        now = time.monotonic()
+        with self.lock:
+            self.datagrams_received += 1
+            self.heartbeats_received[device] = self.heartbeats_received.get(device, 0) + 1
+
+            last_seen = self.last_seen.get(device)
+            if last_seen is not None:
+                if device not in self.inter_arrival:
+                    self.inter_arrival[device] = Histogram(self.INTER_ARRIVAL_BUCKETS_S)
+                self.inter_arrival[device].observe(now - last_seen)
+            self.last_seen[device] = now
+
+    def observe_missed_beat(self) -> None:
+        with self.lock:
+            self.missed_beats += 1
+
+    def observe_restored_beat(self) -> None:
+        with self.lock:
+            self.restored_beats += 1
+
+    def observe_ntfy(self, latency_s: float, ok: bool) -> None:
+        with self.lock:
+            self.ntfy_latency.observe(latency_s)
+            if not ok:
+                self.ntfy_failures += 1
+
+    def render(self) -> str:
+        """Render all the metrics in the Prometheus text exposition format."""
+        now = time.monotonic()
+        with self.lock:
+            last_seen = dict(self.last_seen)
+            heartbeats_received = dict(self.heartbeats_received)
+            inter_arrival: Dict[str, Tuple[List[int], int, float]] = {
+                device: (list(hist.counts), hist.count, hist.sum)
+                for device, hist in self.inter_arrival.items()
+            }
+            datagrams_received = self.datagrams_received
+            missed_beats = self.missed_beats
+            restored_beats = self.restored_beats
+            ntfy_latency = (
+                list(self.ntfy_latency.counts),
+                self.ntfy_latency.count,
+                self.ntfy_latency.sum,
+            )
+            ntfy_failures = self.ntfy_failures
+
+        def restore(buckets: Sequence[float], snapshot: Tuple[List[int], int, float]) -> Histogram:
+            hist = Histogram(buckets)
+            hist.counts, hist.count, hist.sum = snapshot
+            return hist
+
+        lines = [
+            "# HELP heartbeat_listener_uptime_seconds Time since the listener started.",
+            "# TYPE heartbeat_listener_uptime_seconds gauge",
+            f"heartbeat_listener_uptime_seconds {now - self.start_time}",
+            "# HELP heartbeat_listener_datagrams_received_total Datagrams received on the heartbeat "
+            "port, use rate() for the ingest rate.",
+            "# TYPE heartbeat_listener_datagrams_received_total counter",
+            f"heartbeat_listener_datagrams_received_total {datagrams_received}",
+            "# HELP heartbeat_received_total Heartbeats received per device.",
+            "# TYPE heartbeat_received_total counter",
+        ]
+        lines += [
+            f'heartbeat_received_total{{device="{device}"}} {count}'
+            for device, count in sorted(heartbeats_received.items())
+        ]
+        lines += [
+            "# HELP heartbeat_last_seen_age_seconds Time since the last heartbeat of each device.",
+            "# TYPE heartbeat_last_seen_age_seconds gauge",
+        ]
+        lines += [
+            f'heartbeat_last_seen_age_seconds{{device="{device}"}} {now - seen}'
+            for device, seen in sorted(last_seen.items())
+        ]
+        lines += [
+            "# HELP heartbeat_inter_arrival_seconds Time between consecutive heartbeats of each device.",
+            "# TYPE heartbeat_inter_arrival_seconds histogram",
+        ]
+        for device, snapshot in sorted(inter_arrival.items()):
+            lines += restore(self.INTER_ARRIVAL_BUCKETS_S, snapshot).render(
+                "heartbeat_inter_arrival_seconds", f'device="{device}"'
+            )
+        lines += [
+            "# HELP heartbeat_missed_total Heartbeat checks that found the heartbeat delta exceeded.",
+            "# TYPE heartbeat_missed_total counter",
+            f"heartbeat_missed_total {missed_beats}",
+            "# HELP heartbeat_restored_total Heartbeat checks that found a missed heartbeat restored.",
+            "# TYPE heartbeat_restored_total counter",
+            f"heartbeat_restored_total {restored_beats}",
+            "# HELP heartbeat_ntfy_send_seconds Time taken to send a notification to ntfy.sh.",
+            "# TYPE heartbeat_ntfy_send_seconds histogram",
+        ]
+        lines += restore(self.NTFY_LATENCY_BUCKETS_S, ntfy_latency).render("heartbeat_ntfy_send_seconds")
+        lines += [
+            "# HELP heartbeat_ntfy_send_failures_total Notifications that failed to be sent to ntfy.sh.",
+            "# TYPE heartbeat_ntfy_send_failures_total counter",
+            f"heartbeat_ntfy_send_failures_total {ntfy_failures}",
+        ]
+
+        return "\n".join(lines) + "\n"
+
+
+class MetricsServer(ThreadingHTTPServer):
+    """HTTP server exposing the HeartbeatMetrics under /metrics."""
+
+    daemon_threads = True
+
+    def __init__(self, address: Tuple[str, int], metrics: HeartbeatMetrics):
+        self.metrics = metrics
+        super().__init__(address, MetricsRequestHandler)
+
+
+class MetricsRequestHandler(BaseHTTPRequestHandler):
+    server: MetricsServer
+
+    def do_GET(self):
+        if self.path.split("?")[0] != "/metrics":
+            self.send_error(404)
+            return
+
+        payload = self.server.metrics.render().encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+    def log_message(self, format, *args):
+        logging.getLogger(HeartbeatMonitor.__name__).debug(
+            "Metrics request from %s: %s", self.address_string(), format % args
+        )
+
+
 class HeartbeatMonitor:
     """A heartbeat monitoring class to check for heartbeats."""
 
@@ -37,6 +233,7 @@ class HeartbeatMonitor:
         verbosity_lvl: int,
         client_description: str,
         heartbeat_check_interval: datetime.timedelta = datetime.timedelta(hours=5),
+        metrics_address: Optional[Tuple[str, int]] = None,
     ):
         """
         Initialize the heartbeat monitor.
@@ -45,6 +242,8 @@ class HeartbeatMonitor:
         :param ntfy_channel: The ntfy_channel channel to send notifications to
         in case the heartbeat_check_interval is exceeded.
         :param heartbeat_check_interval: The interval to check for heartbeats.
+        :param metrics_address: The (host, port) to serve the Prometheus metrics on. Don't serve
+        any metrics if not given.
         """
 
         self.port = port
@@ -61,6 +260,10 @@ class HeartbeatMonitor:
         # store whether the last heartbeat was missed
         self.last_heartbeat_missed = False
 
+        # metrics related configuration
+        self.metrics = HeartbeatMetrics()
+        self.metrics_address = metrics_address
+
         # setup logging
         self._setup_logger(verbosity_lvl)
 
@@ -81,11 +284,20 @@ class HeartbeatMonitor:
         """
         self.logger.debug("Calling HeartbeatMonitor.start() ...")
 
+        # bind the metrics server before starting any thread, so that failing to do so (e.g., port
+        # already in use) aborts the listener instead of leaving it running without its timer
+        metrics_server: Optional[MetricsServer] = None
+        if self.metrics_address is not None:
+            metrics_server = MetricsServer(self.metrics_address, self.metrics)
+
         self.logger.debug("Starting control loop thread to check for heartbeats ...")
         control_loop_thread = threading.Thread(target=self._run_control_loop)
         control_loop_thread.start()
         self.logger.debug("Control loop thread started.")
 
+        if metrics_server is not None:
+            self._start_metrics_server(metrics_server)
+
         # start a timer to check for heartbeats every heartbeat_check_interval
         # if a heartbeat is not received within this interval, send a notification to the ntfy channel
         self.logger.debug(
@@ -102,6 +314,16 @@ class HeartbeatMonitor:
             self.logger.info("Ctrl-c pressed, exiting.")
             self.heartbeat_timer.cancel()
 
+    def _start_metrics_server(self, metrics_server: MetricsServer) -> None:
+        """Serve the metrics from a separate thread, away from the UDP receive path."""
+        metrics_thread = threading.Thread(
+            target=metrics_server.serve_forever, name="metrics-server", daemon=True
+        )
+        metrics_thread.start()
+        self.logger.info(
+            "Serving metrics at http://%s:%d/metrics", *metrics_server.server_address[:2]
+        )
+
     def _run_control_loop(self):
         """Run the control loop.
 
@@ -113,9 +335,10 @@ class HeartbeatMonitor:
 
         while True:
             message, address = server_socket.recvfrom(1024)
-            del address
             del message
 
+            self.metrics.observe_heartbeat(address[0])
+
             with self.heartbeat_received_lock:
                 self.logger.debug(
                     "Received heartbeat message at %s, resetting last heartbeat time.",
@@ -139,6 +362,7 @@ class HeartbeatMonitor:
                     # if we had missed the last heartbeat, reset the flag and inform the user that all is good now
                     if self.last_heartbeat_missed:
                         self.last_heartbeat_missed = False
+                        self.metrics.observe_restored_beat()
                         logging.warning(
                             f"Connection to client restored. Last heartbeat received at {self.last_heartbeat_time}."
                         )
@@ -157,6 +381,7 @@ class HeartbeatMonitor:
 
                 # heartbeat delta exceeded - send a notification --------------------------------------
                 self.last_heartbeat_missed = True
+                self.metrics.observe_missed_beat()
                 logging.warning(
                     f"Delta for heartbeat exceeded!\n\n"
                     f"- Last heartbeat received at {self.last_heartbeat_time}.\n"
@@ -184,16 +409,25 @@ class HeartbeatMonitor:
         self, msg: str, title: str, priority: NtfyPriorityT, tags: Sequence[str]
     ):
         """Send a message to the ntfy channel."""
-        resp = requests.post(
-            f"https://ntfy.sh/{self.ntfy_channel}",
-            data=msg,
-            headers={
-                "Title": title,
-                "Priority": priority,
-                "Tags": ",".join(tags),
-            },
-        )
+        start = time.monotonic()
+        try:
+            resp = requests.post(
+                f"https://ntfy.sh/{self.ntfy_channel}",
+                data=msg,
+                headers={
+                    "Title": title,
+                    "Priority": priority,
+                    "Tags": ",".join(tags),
+                },
+            )
+        except requests.RequestException as e:
+            self.metrics.observe_ntfy(time.monotonic() - start, ok=False)
+            logging.error(
+                f"Failed to send notification to ntfy.sh channel {self.ntfy_channel}. | Error: {e}"
+            )
+            return
 
+        self.metrics.observe_ntfy(time.monotonic() - start, ok=resp.ok)
         if not resp.ok:
             logging.error(
                 f"Failed to send notification to ntfy.sh channel {self.ntfy_channel}. | "
@@ -300,6 +534,18 @@ def main():
         help="The description of the client application for which the heartbeat is being monitored",
         default="client",
     )
+    parser.add_argument(
+        "--metrics-port",
+        type=int,
+        help="The local port to serve Prometheus metrics on under /metrics. 0 to disable",
+        default=0,
+    )
+    parser.add_argument(
+        "--metrics-addr",
+        type=str,
+        help="The local address to serve Prometheus metrics on",
+        default="127.0.0.1",
+    )
 
     # print some sample usage examples
     epilog_examples: Mapping[str, str] = {
@@ -309,6 +555,7 @@ def main():
         "Set the ntfy channel and a heartbeat check interval": f"{_prog_name} --ntfy ntfy_channel --heartbeat-check-interval 5h",
         "Set a heartbeat check interval of 5 minutes": f"{_prog_name} --heartbeat-check-interval 5m",
         "Set a heartbeat check interval of 10 seconds": f"{_prog_name} --heartbeat-check-interval 10s",
+        "Serve Prometheus metrics on port 9120": f"{_prog_name} --metrics-port 9120",
     }
     longest_epilog_example_key = max(map(len, epilog_examples.keys()))
 
@@ -330,6 +577,7 @@ def main():
         verbosity_lvl=args.verbose,
         heartbeat_check_interval=parse_time_interval(args.heartbeat_check_interval),
         client_description=args.client_description,
+        metrics_address=(args.metrics_addr, args.metrics_port) if args.metrics_port else None,
     ).start()
 
 
@@ -0,0 +1,1008 @@
+#!/usr/bin/env python3
+
+"""
+Network impairment simulator for the babypanel network paths.
+
+It consists of three pieces:
+
+- proxy: TCP + UDP proxy that sits between the babypanel (point BABYBUDDY_SERVER_ADDR/PORT and
+  HEARTBEAT_SERVER_ADDR/PORT of user-conf.h at it) and the Baby Buddy / heartbeat servers, and
+  impairs the traffic according to a scenario - added latency, jitter, packet loss, connection
+  resets, slow-drip responses and servers that never close the connection.
+- standin: Minimal stand-in for the Baby Buddy API and the heartbeat listener, that records every
+  event it receives.
+- suite: Runs every scenario of a scenarios file through the proxy against the stand-in, with a
+  client that replays the requests and timeouts of the firmware, and reports the press latency,
+  lost events and total radio-on time of each scenario.
+"""
+
+
+import argparse
+import dataclasses
+import json
+import logging
+import random
+import select
+import socket
+import statistics
+import struct
+import sys
+import threading
+import time
+import urllib.parse
+from typing import Dict, List, Mapping, Optional, Sequence, Tuple
+
+_prog_name = sys.argv[0].split("/")[-1]
+
+# firmware timing - keep in sync with src/babypanel ----------------------------------------------
+# connectToWifi(): WiFi.begin() is followed by a fixed delay, then by fixed delays between attempts
+WIFI_BEGIN_DELAY_S = 0.5
+WIFI_RETRY_DELAY_S = 5.0
+WIFI_TOTAL_ATTEMPTS = 3
+# WiFiClient::connect() timeout
+TCP_CONNECT_TIMEOUT_S = 5.0
+# Stream::setTimeout() default, applies to every byte readStringUntil() waits for
+STREAM_TIMEOUT_S = 1.0
+# lightSleep(): waitForPendingTx()
+LIGHT_SLEEP_UDP_SETTLE_S = 0.02
+# BBBDClient::postEvent()
+EVENT_DELIVERY_ATTEMPTS = 4
+EVENT_RETRY_BACKOFF_S = 0.25
+EVENT_RESPONSE_TIMEOUT_S = 0.75
+MAX_PENDING_EVENTS = 8
+
+USER_AGENT = "BabyBuddyArcadePanel/0.1.0"
+
+# safety net in case the emulated firmware ends up waiting on a server forever - give up on the
+# press after this long and report it as hung
+HUNG_PRESS_TIMEOUT_S = 30.0
+
+
+def event_tags_json(event_id: str) -> str:
+    """eventTagsJson() of the firmware."""
+    return f'"tags":"[\\"{USER_AGENT}\\",\\"{event_id}\\"]"'
+
+
+# scenarios ---------------------------------------------------------------------------------------
+@dataclasses.dataclass
+class Scenario:
+    """Impairments to apply to the traffic going through the proxy."""
+
+    name: str
+    description: str = ""
+    # added one-way latency, and uniformly distributed jitter on top of it
+    latency_ms: float = 0.0
+    jitter_ms: float = 0.0
+    # probability of losing a packet. UDP datagrams are dropped, TCP segments are retransmitted
+    # after retransmission_timeout_ms (doubling for consecutive losses)
+    loss: float = 0.0
+    retransmission_timeout_ms: float = 200.0
+    # probability that a connection gets reset right after the request is forwarded
+    reset: float = 0.0
+    # forward the responses at this many bytes per second, 0 for no limit
+    drip_bps: int = 0
+    # stall the response after its headers and never close the connection
+    never_close: bool = False
+    # time the access point takes to associate - not proxied, accounted for by the suite
+    association_ms: float = 0.0
+
+    @classmethod
+    def from_dict(cls, d: Mapping) -> "Scenario":
+        unknown = set(d) - {f.name for f in dataclasses.fields(cls)}
+        if unknown:
+            raise ValueError(f"Unknown scenario keys {sorted(unknown)} in scenario {d.get('name')}.")
+        return cls(**d)
+
+
+def load_scenarios(path: str) -> List[Scenario]:
+    """Load the scenarios from a JSON file containing a list of scenario objects."""
+    with open(path, "r", encoding="utf-8") as f:
+        return [Scenario.from_dict(d) for d in json.load(f)]
+
+
+def find_scenario(scenarios: Sequence[Scenario], name: str) -> Scenario:
+    for scenario in scenarios:
+        if scenario.name == name:
+            return scenario
+    raise ValueError(
+        f"No scenario named {name}, available: {', '.join(s.name for s in scenarios)}."
+    )
+
+
+def parse_address(address: str) -> Tuple[str, int]:
+    """Parse a host:port string."""
+    host, _, port = address.rpartition(":")
+    if not host or not port:
+        raise ValueError(f"Invalid address {address}, expected host:port.")
+    return host, int(port)
+
+
+# proxy -------------------------------------------------------------------------------------------
+class ImpairmentProxy:
+    """TCP and UDP proxy impairing the traffic according to a Scenario."""
+
+    CHUNK_SIZE = 1460
+
+    def __init__(
+        self,
+        scenario: Scenario,
+        tcp_listen: Optional[Tuple[str, int]] = None,
+        tcp_upstream: Optional[Tuple[str, int]] = None,
+        udp_listen: Optional[Tuple[str, int]] = None,
+        udp_upstream: Optional[Tuple[str, int]] = None,
+        seed: Optional[int] = None,
+    ):
+        self.scenario = scenario
+        self.tcp_upstream = tcp_upstream
+        self.udp_upstream = udp_upstream
+        self.logger = logging.getLogger(self.__class__.__name__)
+        self.random = random.Random(seed)
+        self.random_lock = threading.Lock()
+        self.stopped = threading.Event()
+
+        self.tcp_socket: Optional[socket.socket] = None
+        if tcp_listen is not None:
+            self.tcp_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            self.tcp_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+            self.tcp_socket.bind(tcp_listen)
+            self.tcp_socket.listen()
+
+        self.udp_socket: Optional[socket.socket] = None
+        if udp_listen is not None:
+            self.udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            self.udp_socket.bind(udp_listen)
+
+    @property
+    def tcp_address(self) -> Tuple[str, int]:
+        assert self.tcp_socket is not None
+        return self.tcp_socket.getsockname()
+
+    @property
+    def udp_address(self) -> Tuple[str, int]:
+        assert self.udp_socket is not None
+        return self.udp_socket.getsockname()
+
+    def start(self) -> None:
+        """Start serving from background threads."""
+        if self.tcp_socket is not None:
+            threading.Thread(target=self._accept_loop, daemon=True).start()
+        if self.udp_socket is not None:
+            threading.Thread(target=self._udp_loop, daemon=True).start()
+
+    def stop(self) -> None:
+        self.stopped.set()
+        for s in (self.tcp_socket, self.udp_socket):
+            if s is not None:
+                s.close()
+
+    def _chance(self, probability: float) -> bool:
+        with self.random_lock:
+            return self.random.random() < probability
+
+    def _one_way_delay_s(self) -> float:
+        with self.random_lock:
+            jitter = self.random.uniform(-self.scenario.jitter_ms, self.scenario.jitter_ms)
+        return max(0.0, self.scenario.latency_ms + jitter) / 1000.0
+
+    def _loss_penalty_s(self) -> float:
+        """Retransmission delay paid by a TCP segment, 0 if it made it through the first time."""
+        penalty_s = 0.0
+        rto_s = self.scenario.retransmission_timeout_ms / 1000.0
+        while self._chance(self.scenario.loss):
+            penalty_s += rto_s
+            rto_s *= 2
+        return penalty_s
+
+    # TCP -----------------------------------------------------------------------------------------
+    def _accept_loop(self) -> None:
+        assert self.tcp_socket is not None and self.tcp_upstream is not None
+        while not self.stopped.is_set():
+            try:
+                client, address = self.tcp_socket.accept()
+            except OSError:
+                return
+
+            self.logger.debug("Accepted connection from %s:%d", *address)
+            try:
+                upstream = socket.create_connection(self.tcp_upstream)
+            except OSError as e:
+                self.logger.warning("Failed to connect upstream: %s", e)
+                client.close()
+                continue
+
+            reset = self._chance(self.scenario.reset)
+            threading.Thread(
+                target=self._pump_requests, args=(client, upstream, reset), daemon=True
+            ).start()
+            threading.Thread(
+                target=self._pump_responses, args=(upstream, client), daemon=True
+            ).start()
+
+    def _pump_requests(self, client: socket.socket, upstream: socket.socket, reset: bool) -> None:
+        """Forward the client -> server direction."""
+        try:
+            while True:
+                data = client.recv(self.CHUNK_SIZE)
+                if not data:
+                    break
+                time.sleep(self._one_way_delay_s() + self._loss_penalty_s())
+                upstream.sendall(data)
+
+                if reset:
+                    # the request made it to the server, but the client will never know
+                    self.logger.debug("Resetting connection")
+                    client.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+                    break
+        except OSError:
+            pass
+        finally:
+            client.close()
+            upstream.close()
+
+    def _pump_responses(self, upstream: socket.socket, client: socket.socket) -> None:
+        """Forward the server -> client direction."""
+        stalled = False
+        try:
+            while True:
+                data = upstream.recv(self.CHUNK_SIZE)
+                if not data:
+                    break
+                if stalled:
+                    continue
+
+                if self.scenario.never_close:
+                    headers_end = data.find(b"\r\n\r\n")
+                    if headers_end != -1:
+                        data = data[: headers_end + 4]
+                        stalled = True
+
+                time.sleep(self._one_way_delay_s() + self._loss_penalty_s())
+                if self.scenario.drip_bps <= 0:
+                    client.sendall(data)
+                    continue
+
+                for i in range(len(data)):
+                    client.sendall(data[i : i + 1])
+                    time.sleep(1.0 / self.scenario.drip_bps)
+
+            if self.scenario.never_close:
+                # keep the client side open until the client gives up on it
+                while client.recv(self.CHUNK_SIZE):
+                    pass
+        except OSError:
+            pass
+        finally:
+            client.close()
+            upstream.close()
+
+    # UDP -----------------------------------------------------------------------------------------
+    def _udp_loop(self) -> None:
+        assert self.udp_socket is not None and self.udp_upstream is not None
+        upstream = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        while not self.stopped.is_set():
+            try:
+                data, _ = self.udp_socket.recvfrom(2048)
+            except OSError:
+                return
+
+            if self._chance(self.scenario.loss):
+                self.logger.debug("Dropping datagram")
+                continue
+
+            threading.Timer(
+                self._one_way_delay_s(), upstream.sendto, args=(data, self.udp_upstream)
+            ).start()
+
+
+# Baby Buddy / heartbeat stand-in -----------------------------------------------------------------
+@dataclasses.dataclass
+class RecordedEvent:
+    """An event as recorded by the stand-in."""
+
+    url: str
+    body: Dict
+    time: float
+    # client event id carried in the tags, if any
+    event_id: Optional[str]
+
+    @staticmethod
+    def event_id_of(payload: Dict) -> Optional[str]:
+        tags = payload.get("tags", [])
+        # the firmware sends the tags as a JSON encoded string
+        if isinstance(tags, str):
+            tags = json.loads(tags)
+        return next((tag for tag in tags if tag.startswith("evt-")), None)
+
+
+class BabyBuddyStandin:
+    """Minimal stand-in for the Baby Buddy API endpoints and the heartbeat listener.
+
+    Speaks just enough HTTP/1.1 for the requests of the firmware, which separates its header lines
+    with a bare \\n and sends a stray \\r\\n after each body, and keeps every connection alive.
+    """
+
+    def __init__(self, http_listen: Tuple[str, int], udp_listen: Tuple[str, int]):
+        self.logger = logging.getLogger(self.__class__.__name__)
+        self.lock = threading.Lock()
+        self.events: List[RecordedEvent] = []
+        self.heartbeats = 0
+        self.next_id = 1
+        self.active_timers = set()
+
+        self.http_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.http_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.http_socket.bind(http_listen)
+        self.http_socket.listen()
+
+        self.udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.udp_socket.bind(udp_listen)
+
+    @property
+    def http_address(self) -> Tuple[str, int]:
+        return self.http_socket.getsockname()
+
+    @property
+    def udp_address(self) -> Tuple[str, int]:
+        return self.udp_socket.getsockname()
+
+    def start(self) -> None:
+        """Start serving from background threads."""
+        threading.Thread(target=self._accept_loop, daemon=True).start()
+        threading.Thread(target=self._udp_loop, daemon=True).start()
+
+    def stop(self) -> None:
+        self.http_socket.close()
+        self.udp_socket.close()
+
+    def _udp_loop(self) -> None:
+        while True:
+            try:
+                self.udp_socket.recvfrom(1024)
+            except OSError:
+                return
+            with self.lock:
+                self.heartbeats += 1
+
+    def _accept_loop(self) -> None:
+        while True:
+            try:
+                conn, _ = self.http_socket.accept()
+            except OSError:
+                return
+            threading.Thread(target=self._serve, args=(conn,), daemon=True).start()
+
+    def _serve(self, conn: socket.socket) -> None:
+        buffer = b""
+        try:
+            while True:
+                # skip the stray line endings between requests, then wait for the full headers
+                buffer = buffer.lstrip(b"\r\n")
+                while b"\n\n" not in buffer.replace(b"\r", b""):
+                    data = conn.recv(4096)
+                    if not data:
+                        return
+                    buffer = buffer.lstrip(b"\r\n") + data
+
+                head, body_start = self._split_headers(buffer)
+                lines = [line.strip("\r") for line in head.decode("utf-8").split("\n")]
+                method, url, _ = lines[0].split(" ", 2)
+                headers = {
+                    k.strip().lower(): v.strip()
+                    for k, _, v in (line.partition(":") for line in lines[1:] if line)
+                }
+
+                content_length = int(headers.get("content-length", "0"))
+                buffer = buffer[body_start:]
+                while len(buffer) < content_length:
+                    data = conn.recv(4096)
+                    if not data:
+                        return
+                    buffer += data
+                body, buffer = buffer[:content_length], buffer[content_length:]
+
+                status, payload = self._handle(method, url, body.decode("utf-8"))
+                conn.sendall(self._format_response(status, payload))
+        except (OSError, ValueError) as e:
+            self.logger.debug("Closing connection: %s", e)
+        finally:
+            conn.close()
+
+    @staticmethod
+    def _split_headers(buffer: bytes) -> Tuple[bytes, int]:
+        """Split the headers off the buffer, return them and the offset the body starts at."""
+        for separator in (b"\r\n\r\n", b"\n\n", b"\n\r\n"):
+            end = buffer.find(separator)
+            if end != -1:
+                return buffer[:end], end + len(separator)
+        raise ValueError("Incomplete headers")
+
+    @staticmethod
+    def _format_response(status: int, payload: Dict) -> bytes:
+        reasons = {200: "OK", 201: "Created", 400: "Bad Request", 404: "Not Found"}
+        body = json.dumps(payload)
+        # like the real server, the body is not terminated by a line ending
+        return (
+            f"HTTP/1.1 {status} {reasons[status]}\r\n"
+            "Content-Type: application/json\r\n"
+            f"Content-Length: {len(body)}\r\n"
+            "Connection: keep-alive\r\n"
+            "\r\n"
+            f"{body}"
+        ).encode("utf-8")
+
+    def _handle(self, method: str, url: str, body: str) -> Tuple[int, Dict]:
+        if not url.startswith("/api/"):
+            return 404, {"detail": "Not found."}
+
+        if method == "GET":
+            path, _, query = url.partition("?")
+            params = urllib.parse.parse_qs(query)
+            tag = params.get("tags", [None])[0]
+            limit = int(params.get("limit", ["100"])[0])
+            with self.lock:
+                # like Baby Buddy, only accept tags that exist, i.e., that some entry was created with
+                if tag is not None and all(e.event_id != tag for e in self.events):
+                    return 400, {
+                        "tags": [
+                            f"Select a valid choice. {tag} is not one of the available choices."
+                        ]
+                    }
+                results = [
+                    e.body for e in self.events if e.url == path and tag in (None, e.event_id)
+                ]
+            return 200, {"count": len(results), "next": None, "results": results[:limit]}
+
+        if method != "POST":
+            return 404, {"detail": "Not found."}
+
+        try:
+            payload = json.loads(body) if body.strip() else {}
+        except json.JSONDecodeError as e:
+            return 400, {"detail": f"JSON parse error - {e}"}
+
+        with self.lock:
+            new_id = self.next_id
+            self.next_id += 1
+
+            if url == "/api/timers/":
+                self.active_timers.add(new_id)
+                return 201, {"id": new_id, "child": payload.get("child")}
+
+            if "timer" in payload:
+                timer_id = int(payload["timer"])
+                if timer_id not in self.active_timers:
+                    return 400, {"timer": [f'Invalid pk "{timer_id}" - object does not exist.']}
+                self.active_timers.remove(timer_id)
+
+            self.events.append(
+                RecordedEvent(
+                    url=url,
+                    body=payload,
+                    time=time.monotonic(),
+                    event_id=RecordedEvent.event_id_of(payload),
+                )
+            )
+            return 201, dict(payload, id=new_id)
+
+
+# firmware emulation ------------------------------------------------------------------------------
+@dataclasses.dataclass
+class PendingEvent:
+    """PendingEvent of the firmware."""
+
+    url: str
+    body: str
+    event_id: str
+    maybe_delivered: bool = False
+    needs_timer: bool = False
+    timer_id: int = 0
+
+
+class FirmwareEmulator:
+    """Replays the network behaviour of the firmware for a press or a heartbeat.
+
+    Mirrors connectToWifi(), BBBDClient::connect(), BBBDClient::makeRequest(),
+    BBBDClient::postEvent() and lightSleep(), including the Stream timeouts of readStringUntil().
+    """
+
+    def __init__(self, http_address: Tuple[str, int], udp_address: Tuple[str, int]):
+        self.http_address = http_address
+        self.udp_address = udp_address
+        self.sock: Optional[socket.socket] = None
+        self.stream_timeout_s = STREAM_TIMEOUT_S
+        self.deadline = 0.0
+        self.pending_events: List[PendingEvent] = []
+        self.random = random.Random()
+        # whether the response of the last request was left (partly) unread in the socket
+        self.response_unread = False
+
+    @staticmethod
+    def association_time_s(association_ms: float) -> float:
+        """Time spent in connectToWifi() for an access point that takes association_ms."""
+        association_s = association_ms / 1000.0
+        elapsed_s = WIFI_BEGIN_DELAY_S
+        attempts = 0
+        while elapsed_s < association_s and attempts != WIFI_TOTAL_ATTEMPTS:
+            elapsed_s += WIFI_RETRY_DELAY_S
+            attempts += 1
+        return elapsed_s
+
+    def new_event_id(self) -> str:
+        return f"evt-sim-{self.random.getrandbits(32):x}"
+
+    def set_timeout(self, timeout_s: float) -> None:
+        self.stream_timeout_s = timeout_s
+        if self.sock is not None:
+            self.sock.settimeout(timeout_s)
+
+    def connect(self) -> bool:
+        self.close()
+        try:
+            self.sock = socket.create_connection(self.http_address, timeout=TCP_CONNECT_TIMEOUT_S)
+        except OSError:
+            return False
+        self.sock.settimeout(self.stream_timeout_s)
+        self.response_unread = False
+        return True
+
+    def connected(self) -> bool:
+        if self.sock is None:
+            return False
+        # poll without waiting, the socket timeout would otherwise apply to the peek as well
+        try:
+            readable, _, _ = select.select([self.sock], [], [], 0)
+            if not readable:
+                return True
+            return self.sock.recv(1, socket.MSG_PEEK) != b""
+        except OSError:
+            return False
+
+    def close(self) -> None:
+        if self.sock is not None:
+            self.sock.close()
+            self.sock = None
+
+    def read_string_until(self, terminator: bytes) -> bytes:
+        """Stream::readStringUntil() - give up after the stream timeout without any new byte."""
+        if time.monotonic() > self.deadline:
+            raise TimeoutError("Press hung")
+
+        assert self.sock is not None
+        out = b""
+        while True:
+            try:
+                c = self.sock.recv(1)
+            except socket.timeout:
+                return out
+            except OSError:
+                c = b""
+            if not c:
+                # a dead connection never has anything available, so we wait the timeout out
+                time.sleep(self.stream_timeout_s)
+                return out
+            if c == terminator:
+                return out
+            out += c
+
+    def read_bytes(self, length: int) -> bytes:
+        """Stream::readBytes() - give up after the stream timeout without any new byte."""
+        if time.monotonic() > self.deadline:
+            raise TimeoutError("Press hung")
+
+        assert self.sock is not None
+        out = b""
+        while len(out) < length:
+            try:
+                data = self.sock.recv(length - len(out))
+            except socket.timeout:
+                return out
+            except OSError:
+                data = b""
+            if not data:
+                time.sleep(self.stream_timeout_s)
+                return out
+            out += data
+        return out
+
+    def make_request(
+        self, method: str, url: str, body: Optional[str], wait_for_response: bool = False
+    ) -> Tuple[int, str]:
+        """BBBDClient::makeRequest(), returns the response status and body."""
+        assert self.sock is not None
+        request = (
+            f"{method} {url} HTTP/1.1\n"
+            f"Host: {self.http_address[0]}:{self.http_address[1]}\n"
+            "Connection: keep-alive\n"
+            f"User-Agent: {USER_AGENT}\n"
+            "Content-Type: application/json\n"
+            "Authorization: Token standin\n"
+        )
+        if body is not None:
+            request += f"Content-Length: {len(body)}\n\n{body}\r\n"
+        else:
+            request += "\r\n"
+        try:
+            self.sock.sendall(request.encode("utf-8"))
+        except OSError:
+            pass
+
+        line = self.read_string_until(b"\n")
+        status = 0
+        if line.startswith(b"HTTP/"):
+            try:
+                status = int(line.split(b" ")[1])
+            except (IndexError, ValueError):
+                pass
+        if not wait_for_response:
+            self.response_unread = True
+            return status, ""
+
+        complete = line != b""
+        content_length = -1
+        while complete and line != b"\r":
+            line = self.read_string_until(b"\n")
+            if not line:
+                complete = False
+                break
+            if line.lower().startswith(b"content-length:"):
+                content_length = int(line[len(b"content-length:") :].strip())
+
+        response_body = b""
+        if complete and content_length >= 0:
+            response_body = self.read_bytes(content_length)
+            complete = len(response_body) == content_length
+        elif complete:
+            response_body = self.read_string_until(b"\n")
+            complete = False
+
+        self.response_unread = not complete
+        return status, response_body.decode("utf-8", errors="replace")
+
+    def prepare_attempt(self, attempt: int) -> bool:
+        if attempt > 0:
+            time.sleep(EVENT_RETRY_BACKOFF_S * attempt)
+        return (attempt == 0 and self.connected() and not self.response_unread) or self.connect()
+
+    def request_timer(self) -> int:
+        status, body = self.make_request("POST", "/api/timers/", '{"child": 1}', True)
+        if not 200 <= status < 300:
+            return 0
+        try:
+            return int(json.loads(body)["id"])
+        except (ValueError, KeyError, TypeError):
+            return 0
+
+    def create_timer(self) -> int:
+        self.set_timeout(EVENT_RESPONSE_TIMEOUT_S)
+        timer_id = 0
+        for attempt in range(EVENT_DELIVERY_ATTEMPTS):
+            if timer_id:
+                break
+            if self.prepare_attempt(attempt):
+                timer_id = self.request_timer()
+        self.set_timeout(STREAM_TIMEOUT_S)
+        return timer_id
+
+    def count_events(self, url: str, event_id: str) -> int:
+        status, body = self.make_request("GET", f"{url}?tags={event_id}&limit=1", None, True)
+        if 400 <= status < 500 and status not in (408, 429):
+            return 0
+        if status != 200:
+            return -1
+        try:
+            return int(json.loads(body)["count"])
+        except (ValueError, KeyError):
+            return -1
+
+    def deliver_event(self, event: PendingEvent) -> bool:
+        for attempt in range(EVENT_DELIVERY_ATTEMPTS):
+            if not self.prepare_attempt(attempt):
+                continue
+
+            if event.maybe_delivered:
+                count = self.count_events(event.url, event.event_id)
+                if count > 0:
+                    return True
+                if count < 0:
+                    continue
+
+            if event.needs_timer and event.timer_id == 0:
+                event.timer_id = self.request_timer()
+                if event.timer_id == 0:
+                    continue
+
+            if self.response_unread and not self.connect():
+                continue
+
+            body = event.body
+            if event.needs_timer:
+                body = f'{{"timer":"{event.timer_id}",' + body[1:]
+            event.maybe_delivered = True
+            status, _ = self.make_request("POST", event.url, body)
+            if 200 <= status < 300:
+                return True
+            if 400 <= status < 500 and status not in (408, 429):
+                return True
+
+        return False
+
+    def post_event(self, url: str, body: str, event_id: str, needs_timer: bool = False) -> bool:
+        if len(self.pending_events) == MAX_PENDING_EVENTS:
+            self.pending_events.pop(0)
+        self.pending_events.append(
+            PendingEvent(url=url, body=body, event_id=event_id, needs_timer=needs_timer)
+        )
+        return self.deliver_pending_events()
+
+    def deliver_pending_events(self) -> bool:
+        self.set_timeout(EVENT_RESPONSE_TIMEOUT_S)
+        kept = []
+        link_down = False
+        for event in self.pending_events:
+            if link_down or not self.deliver_event(event):
+                kept.append(event)
+                link_down = link_down or not self.connected()
+        self.pending_events = kept
+        self.set_timeout(STREAM_TIMEOUT_S)
+        return not kept
+
+    def press(self, press_index: int) -> Optional[str]:
+        """Replay a press, alternating between a diaper change and a (timer based) feeding.
+
+        :return: The client event id of the press, None if it never got to generate one.
+        """
+        self.deadline = time.monotonic() + HUNG_PRESS_TIMEOUT_S
+        try:
+            event_id = self.new_event_id()
+            if press_index % 2 == 0:
+                body = '{"child":1,"wet":"false","solid":"true",' + event_tags_json(event_id) + "}\r"
+                self.post_event("/api/changes/", body, event_id)
+            else:
+                body = '{"method":"bottle","type":"formula",' + event_tags_json(event_id) + "}\r"
+                self.post_event("/api/feedings/", body, event_id, needs_timer=True)
+
+            self.wait_for_pending_tx()
+            return event_id
+        finally:
+            self.close()
+
+    def heartbeat(self) -> None:
+        """BBBDClient::connectAndSendHeartbeat(), retrying the pending events as well."""
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.sendto(b"\n", self.udp_address)
+        sock.close()
+
+        self.deadline = time.monotonic() + HUNG_PRESS_TIMEOUT_S
+        try:
+            if self.pending_events:
+                self.deliver_pending_events()
+        finally:
+            self.close()
+        self.wait_for_pending_tx()
+
+    @staticmethod
+    def wait_for_pending_tx() -> None:
+        # sendall() already returned, so there's no TCP data left to flush
+        time.sleep(LIGHT_SLEEP_UDP_SETTLE_S)
+
+
+# suite -------------------------------------------------------------------------------------------
+@dataclasses.dataclass
+class ScenarioReport:
+    scenario: Scenario
+    presses: int
+    lost_events: int
+    duplicate_events: int
+    hung_presses: int
+    latencies_s: List[float]
+    radio_on_s: float
+    heartbeats_sent: int
+    heartbeats_lost: int
+
+    HEADER = (
+        f"{'scenario':<18} {'lost':>5} {'dup':>4} {'hung':>5} {'p50 [s]':>8} {'p95 [s]':>8} "
+        f"{'max [s]':>8} {'radio-on [s]':>13} {'hb lost':>8}"
+    )
+
+    def row(self) -> str:
+        def fmt(value: Optional[float]) -> str:
+            return f"{value:8.2f}" if value is not None else f"{'-':>8}"
+
+        latencies = sorted(self.latencies_s)
+        p50 = statistics.median(latencies) if latencies else None
+        p95 = latencies[min(len(latencies) - 1, int(0.95 * len(latencies)))] if latencies else None
+        p_max = latencies[-1] if latencies else None
+
+        return (
+            f"{self.scenario.name:<18} {self.lost_events:>5} {self.duplicate_events:>4} "
+            f"{self.hung_presses:>5} {fmt(p50)} {fmt(p95)} {fmt(p_max)} {self.radio_on_s:>13.2f} "
+            f"{self.heartbeats_lost:>8}"
+        )
+
+
+def run_scenario(scenario: Scenario, presses: int, seed: Optional[int]) -> ScenarioReport:
+    """Run the presses and heartbeats of a scenario against a fresh stand-in and proxy."""
+    standin = BabyBuddyStandin(("127.0.0.1", 0), ("127.0.0.1", 0))
+    standin.start()
+    proxy = ImpairmentProxy(
+        scenario,
+        tcp_listen=("127.0.0.1", 0),
+        tcp_upstream=standin.http_address,
+        udp_listen=("127.0.0.1", 0),
+        udp_upstream=standin.udp_address,
+        seed=seed,
+    )
+    proxy.start()
+    emulator = FirmwareEmulator(proxy.tcp_address, proxy.udp_address)
+
+    association_s = FirmwareEmulator.association_time_s(scenario.association_ms)
+    report = ScenarioReport(
+        scenario=scenario,
+        presses=presses,
+        lost_events=0,
+        duplicate_events=0,
+        hung_presses=0,
+        latencies_s=[],
+        radio_on_s=0.0,
+        heartbeats_sent=0,
+        heartbeats_lost=0,
+    )
+
+    # client event id -> start of the press that generated it
+    press_starts: Dict[str, float] = {}
+    try:
+        for i in range(presses):
+            start = time.monotonic()
+            try:
+                event_id = emulator.press(i)
+                if event_id is not None:
+                    press_starts[event_id] = start
+            except TimeoutError:
+                report.hung_presses += 1
+            # the radio is on from waking up until going back to light sleep
+            report.radio_on_s += association_s + (time.monotonic() - start)
+
+            # the next wakeup retries whatever is still pending
+            start = time.monotonic()
+            try:
+                emulator.heartbeat()
+            except TimeoutError:
+                pass
+            report.radio_on_s += association_s + (time.monotonic() - start)
+            report.heartbeats_sent += 1
+
+        time.sleep((scenario.latency_ms + scenario.jitter_ms) / 1000.0 + 0.2)
+        report.heartbeats_lost = report.heartbeats_sent - standin.heartbeats
+    finally:
+        proxy.stop()
+        standin.stop()
+
+    # match the recorded events to the presses through their client event ids
+    recorded: Dict[str, List[RecordedEvent]] = {}
+    for event in standin.events:
+        if event.event_id in press_starts:
+            recorded.setdefault(event.event_id, []).append(event)
+    for event_id, events in recorded.items():
+        report.duplicate_events += len(events) - 1
+        report.latencies_s.append(association_s + events[0].time - press_starts[event_id])
+    report.lost_events = presses - len(recorded)
+
+    return report
+
+
+def run_suite(scenarios: Sequence[Scenario], presses: int, seed: Optional[int]) -> None:
+    logger = logging.getLogger("suite")
+    reports = []
+    for scenario in scenarios:
+        logger.info("Running scenario %s - %s ...", scenario.name, scenario.description)
+        reports.append(run_scenario(scenario, presses, seed))
+
+    print(f"{presses} presses per scenario, latencies are press -> event recorded by the server\n")
+    print(ScenarioReport.HEADER)
+    print("-" * len(ScenarioReport.HEADER))
+    for report in reports:
+        print(report.row())
+
+
+# run ---------------------------------------------------------------------------------------------
+class Formatter(argparse.ArgumentDefaultsHelpFormatter, argparse.RawTextHelpFormatter):
+    pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=Formatter)
+    parser.add_argument(
+        "-v",
+        "--verbose",
+        dest="verbose",
+        action="count",
+        default=0,
+        help="Increase verbosity of the logger",
+    )
+    parser.add_argument(
+        "--scenarios",
+        type=str,
+        help="JSON file with the scenarios to pick from",
+        default=f"{sys.path[0]}/scenarios.json",
+    )
+    parser.add_argument("--seed", type=int, help="Seed for the impairments", default=None)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    proxy_parser = subparsers.add_parser(
+        "proxy", help="Run the impairment proxy", formatter_class=Formatter
+    )
+    proxy_parser.add_argument("scenario", type=str, help="Name of the scenario to apply")
+    proxy_parser.add_argument("--tcp-listen", type=str, default="0.0.0.0:8000")
+    proxy_parser.add_argument("--tcp-upstream", type=str, help="Baby Buddy server host:port")
+    proxy_parser.add_argument("--udp-listen", type=str, default="0.0.0.0:12000")
+    proxy_parser.add_argument("--udp-upstream", type=str, help="Heartbeat listener host:port")
+
+    standin_parser = subparsers.add_parser(
+        "standin", help="Run the Baby Buddy / heartbeat stand-in", formatter_class=Formatter
+    )
+    standin_parser.add_argument("--http-listen", type=str, default="127.0.0.1:8001")
+    standin_parser.add_argument("--udp-listen", type=str, default="127.0.0.1:12001")
+
+    suite_parser = subparsers.add_parser(
+        "suite", help="Run the scenario suite and report", formatter_class=Formatter
+    )
+    suite_parser.add_argument("--presses", type=int, default=10, help="Presses per scenario")
+    suite_parser.add_argument(
+        "--only", type=str, nargs="+", default=None, help="Only run these scenarios"
+    )
+
+    epilog_examples: Mapping[str, str] = {
+        "Run all the scenarios": f"{_prog_name} suite",
+        "Run a couple of scenarios": f"{_prog_name} suite --only baseline slow-drip",
+        "Run the stand-in": f"{_prog_name} standin",
+        "Put the board behind a lossy link": (
+            f"{_prog_name} proxy lossy --tcp-upstream 127.0.0.1:8001 "
+            "--udp-upstream 127.0.0.1:12001"
+        ),
+    }
+    longest_epilog_example_key = max(map(len, epilog_examples.keys()))
+    parser.epilog = f'Example usages:\n{"=" * 30}\n\n' + "\n".join(
+        f"  {key.ljust(longest_epilog_example_key)} : {value}"
+        for key, value in epilog_examples.items()
+    )
+
+    args = parser.parse_args()
+    logging.basicConfig(
+        format="%(asctime)s | %(levelname)-8s | %(message)s",
+        level={0: logging.WARNING, 1: logging.INFO}.get(args.verbose, logging.DEBUG),
+        datefmt="%Y%m%d %H:%M:%S",
+    )
+    scenarios = load_scenarios(args.scenarios)
+
+    if args.command == "suite":
+        if args.only:
+            scenarios = [find_scenario(scenarios, name) for name in args.only]
+        run_suite(scenarios, args.presses, args.seed)
+        return
+
+    if args.command == "standin":
+        server = BabyBuddyStandin(
+            parse_address(args.http_listen), parse_address(args.udp_listen)
+        )
+    else:
+        if args.tcp_upstream is None and args.udp_upstream is None:
+            parser.error("proxy needs at least one of --tcp-upstream / --udp-upstream")
+        server = ImpairmentProxy(
+            find_scenario(scenarios, args.scenario),
+            tcp_listen=parse_address(args.tcp_listen) if args.tcp_upstream else None,
+            tcp_upstream=parse_address(args.tcp_upstream) if args.tcp_upstream else None,
+            udp_listen=parse_address(args.udp_listen) if args.udp_upstream else None,
+            udp_upstream=parse_address(args.udp_upstream) if args.udp_upstream else None,
+            seed=args.seed,
+        )
+
+    server.start()
+    logging.getLogger(_prog_name).info("Running, press Ctrl-c to exit.")
+    try:
+        threading.Event().wait()
+    except KeyboardInterrupt:
+        server.stop()
+
+
+if __name__ == "__main__":
+    main()
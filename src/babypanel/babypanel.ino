@@ -1,16 +1,31 @@
+#include "boot.h"
 #include "buttons.h"
 #include "conf.h"
 #include "wifi.h"
 
 #include "esp.h"
+#include "power.h"
 
 void setup()
 {
+  bootProfileMarkSetupEntry();
+
+#ifdef DEBUG
   Serial.begin(BAUD_RATE);
+#endif
+
+  // poll the buttons at the lowest clock, the governor boosts it whenever there's work to do
+  setPowerPhase(PowerPhase::Idle);
 
   // setup button pins
   setupGPIOPins();
 
+  // fast path - a press woke/reset the board, serve it right away instead of going to sleep first
+  if (dispatchLatchedPresses())
+  {
+    return;
+  }
+
   // go to light sleep and wait for button presses
   lightSleep();
 }
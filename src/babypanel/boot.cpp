@@ -0,0 +1,67 @@
+#include "boot.h"
+#include "buttons.h"
+#include "conf.h"
+#include "common.h"
+
+BootProfile kBootProfile;
+
+// runs before every other static initializer (the ones building the client, the button configs
+// etc.) - keep it to setting up the button pins and reading the GPIO input register only
+__attribute__((constructor(101))) static void latchBootGpioState()
+{
+  // an open button on a pin that's still floating could read low and be taken for a press - pull
+  // the button pins up first, like setupGPIOPins() does, and give them the time to settle
+  for (int i = 0; i < 5; i++)
+  {
+    pinMode(BUTTON_PINS[i], INPUT_PULLUP);
+  }
+  delayMicroseconds(kBootPullupSettleUs);
+
+  kBootProfile.gpioState = GPI;
+  kBootProfile.gpioLatchUs = micros();
+}
+
+size_t BootProfile::printTo(Print& p) const
+{
+  size_t size = 0;
+  size += p.print("GPIO state at boot: 0x");
+  size += p.print(gpioState, HEX);
+  size += p.print("\nreset -> GPIO latched [us]: ");
+  size += p.print(gpioLatchUs);
+  size += p.print("\nreset -> setup() [us]: ");
+  size += p.print(setupEntryUs);
+  size += p.print("\nreset -> buttons ready [us]: ");
+  size += p.print(buttonsReadyUs);
+  size += p.print("\nreset -> first byte on the wire [us]: ");
+  size += p.print(firstTxUs);
+  return size;
+}
+
+bool bootPinLatchedLow(int pin) { return (kBootProfile.gpioState & (1U << pin)) == 0; }
+
+void bootProfileMarkSetupEntry()
+{
+  if (kBootProfile.setupEntryUs == 0)
+  {
+    kBootProfile.setupEntryUs = micros();
+  }
+}
+
+void bootProfileMarkButtonsReady()
+{
+  if (kBootProfile.buttonsReadyUs == 0)
+  {
+    kBootProfile.buttonsReadyUs = micros();
+  }
+}
+
+void bootProfileMarkFirstTx()
+{
+  if (kBootProfile.firstTxUs != 0)
+  {
+    return;
+  }
+
+  kBootProfile.firstTxUs = micros();
+  announce("Boot profile", kBootProfile);
+}
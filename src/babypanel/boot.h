@@ -0,0 +1,59 @@
+/**
+ * Cold-boot fast path and boot-time profiling
+ *
+ * The GPIO input register is latched from a high-priority static constructor, i.e., before any
+ * other static initializer or setup() runs, so that a button press that woke/reset the board is
+ * not lost while the rest of the firmware is initializing.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Time to let the button pins settle after enabling their pull-ups, before latching them
+ */
+constexpr unsigned int kBootPullupSettleUs = 50;
+
+// BootProfile class -------------------------------------------------------------------------------
+/**
+ * Timestamps (in us since reset) of the milestones of a cold boot
+ */
+class BootProfile : public Printable
+{
+public:
+  size_t printTo(Print& p) const override;
+
+  /** state of all GPIO inputs, latched before any other initialization */
+  uint32_t gpioState = 0;
+
+  /** reset -> GPIO inputs latched */
+  uint32_t gpioLatchUs = 0;
+  /** reset -> entry to setup() */
+  uint32_t setupEntryUs = 0;
+  /** reset -> button pins configured and handed to the button handlers */
+  uint32_t buttonsReadyUs = 0;
+  /** reset -> first byte handed to the network stack (HTTP request or heartbeat) */
+  uint32_t firstTxUs = 0;
+};
+
+/**
+ * Statically initialized boot profile of the current boot
+ */
+extern BootProfile kBootProfile;
+
+/**
+ * Whether the given pin read low (i.e., button pressed) at the time the GPIO inputs were latched
+ */
+bool bootPinLatchedLow(int pin);
+
+/**
+ * @name Boot profile milestones
+ *
+ * Each milestone is recorded only once per boot, subsequent calls are no-ops
+ */
+//@{
+void bootProfileMarkSetupEntry();
+void bootProfileMarkButtonsReady();
+/** Also prints the full boot profile */
+void bootProfileMarkFirstTx();
+//@}
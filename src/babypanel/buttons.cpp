@@ -1,4 +1,6 @@
 #include "buttons.h"
+#include "boot.h"
+#include "conf.h"
 #include "common.h"
 #include "esp.h"
 #include "wifi.h"
@@ -42,23 +44,16 @@ void feedCb(AceButton* btn, uint8_t eventType, uint8_t buttonState, const char*
   const int btnId = btn->getId();
   DEBUG_PRINT(BUTTON_DESCRIPTIONS[btnId]);
 
-  if (!kBBBDClient.connect())
-  {
-    return;
-  }
-
   // I don't want to signal both the start and end of the breast feed so on start, I'll create a
-  // timer, then immediately use it to make a valid breast feed request
+  // timer, then immediately use it to make a valid breast feed request - the timer is created
+  // along with the delivery of the event, so that it's retried with it
 
-  // create a timer
-  const auto timerId = kBBBDClient.createTimer();
-
-  // make breast feed request
+  // make breast feed request - no need for a connection upfront, the event is kept until delivered
   const char* url = "/api/feedings/";
 
-  const String body
-      = String("{\"timer\":\"") + timerId + "\"," + feedJSON + "," + kBabyBuddyTagJson + "}\r";
-  kBBBDClient.makeRequest(HTTPMethod::POST, url, &body);
+  const String eventId = newEventId();
+  const String body = String("{") + feedJSON + "," + eventTagsJson(eventId) + "}\r";
+  kBBBDClient.postEvent(url, body, eventId, true);
 }
 
 void breastFeedCb(AceButton* btn, uint8_t eventType, uint8_t buttonState)
@@ -92,17 +87,13 @@ void diaperCb(AceButton* btn, uint8_t eventType, uint8_t buttonState)
   const int btnId = btn->getId();
   DEBUG_PRINTLN(BUTTON_DESCRIPTIONS[btnId]);
 
-  if (!kBBBDClient.connect())
-  {
-    return;
-  }
-
-  // make diaper request
+  // make diaper request - no need for a connection upfront, the event is kept until delivered
   const char* url = "/api/changes/";
 
+  const String eventId = newEventId();
   const String body = String("{\"child\":") + STR(BABYBUDDY_CHILD_ID) + "," + diaperContents + ","
-                      + kBabyBuddyTagJson + "}\r";
-  kBBBDClient.makeRequest(HTTPMethod::POST, url, &body);
+                      + eventTagsJson(eventId) + "}\r";
+  kBBBDClient.postEvent(url, body, eventId);
 }
 
 // supplementary callback for activities with a clear start and end --------------------------------
@@ -122,14 +113,16 @@ void startEndRequestCb(AceButton* btn, uint8_t eventType, uint8_t buttonState, c
     DEBUG_PRINT(description);
     DEBUG_PRINTLN(" start");
 
-    // create timer, assign it to the button configuration
+    // create timer, assign it to the button configuration - no need for a connection upfront,
+    // createTimer() connects and retries on its own
     DEBUG_PRINTLN("Creating timer ...");
-    if (!kBBBDClient.connect())
+    const int timerId = kBBBDClient.createTimer();
+    if (timerId == 0)
     {
-      return;
+      DEBUG_PRINTLN("Failed to create the timer");
     }
 
-    static_cast<TimerButtonConfig*>(btn->getButtonConfig())->setTimerId(kBBBDClient.createTimer());
+    static_cast<TimerButtonConfig*>(btn->getButtonConfig())->setTimerId(timerId);
     return;
   }
   case AceButton::kEventDoubleClicked:
@@ -149,12 +142,8 @@ void startEndRequestCb(AceButton* btn, uint8_t eventType, uint8_t buttonState, c
     // set the timer to 0 in the button configuration to mark that there's no active timer
     static_cast<TimerButtonConfig*>(btn->getButtonConfig())->setTimerId(0);
 
-    // make tummy time request end request
-    if (!kBBBDClient.connect())
-    {
-      return;
-    }
-
+    // make tummy time request end request - the event is kept until delivered
+    const String eventId = newEventId();
     String body = String("{\"timer\":\"") + timerId + "\" ";
 
     if (jsonExtra != nullptr)
@@ -162,9 +151,11 @@ void startEndRequestCb(AceButton* btn, uint8_t eventType, uint8_t buttonState, c
       body += ",";
       body += jsonExtra;
     }
-    body += "," + kBabyBuddyTagJson + "}\r";
+    body += ",";
+    body += eventTagsJson(eventId);
+    body += "}\r";
 
-    kBBBDClient.makeRequest(HTTPMethod::POST, url, &body);
+    kBBBDClient.postEvent(url, body, eventId);
 
     break;
   }
@@ -265,6 +256,35 @@ void setupGPIOPins()
 
     bc->setEventHandler(handleEvent);
   }
+
+  // mark it here rather than on the first check, the fast path may send before that ever happens
+  bootProfileMarkButtonsReady();
+}
+
+bool dispatchLatchedPresses()
+{
+  bool pressLatched = false;
+  for (int i = 0; i < 5; i++)
+  {
+    if (!bootPinLatchedLow(BUTTON_PINS[i]))
+    {
+      continue;
+    }
+    pressLatched = true;
+
+    // still held down, the button handler will pick up its release on the next check
+    if (digitalRead(BUTTON_PINS[i]) == LOW)
+    {
+      continue;
+    }
+
+    // released while we were still booting, the button handler never saw it - replay it as a click
+    DEBUG_PRINT("Replaying press latched at boot, button #");
+    DEBUG_PRINTLN(i);
+    handleEvent(&ACE_BUTTONS[i], AceButton::kEventClicked, HIGH);
+  }
+
+  return pressLatched;
 }
 
 void checkButtons()
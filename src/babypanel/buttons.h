@@ -63,5 +63,16 @@ void handleEvent(AceButton* btn, uint8_t eventType, uint8_t buttonState);
 // setup GPIO pins ---------------------------------------------------------------------------------
 void setupGPIOPins();
 
+// cold-boot fast path -----------------------------------------------------------------------------
+/**
+ * Serve the button presses that were latched at boot, i.e., the ones that woke/reset the board
+ *
+ * Presses that were already released by the time the GPIO pins were setup are dispatched right
+ * away, presses still held down are left to the regular button handling.
+ *
+ * @return Whether any button press was latched at boot
+ */
+bool dispatchLatchedPresses();
+
 // check buttons -----------------------------------------------------------------------------------
 void checkButtons();
@@ -14,4 +14,5 @@
 
 /* #define HTTP_ALWAYS_WAIT_FOR_RESPONSE_OVERRIDE */
 
+// comment out for the fastest boot - skips setting up the serial port and all the debug logging
 #define DEBUG
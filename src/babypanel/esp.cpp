@@ -2,11 +2,30 @@
 #include <user_interface.h>
 
 #include "esp.h"
+#include "wifi.h"
+
+// after wifi.h, which brings in conf.h and with it DEBUG
+#include "common.h"
+
+void waitForPendingTx()
+{
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    return;
+  }
+
+  if (kBBBDClient.connected() && !kBBBDClient.flush(kLightSleepTxTimeoutMs))
+  {
+    DEBUG_PRINTLN("Timed out waiting for pending TCP data to be sent");
+  }
+
+  delay(kLightSleepUdpSettleMs);
+}
 
 void lightSleep()
 {
-  // IMPORTANT! delay to give the wifi thread some time to write any pending data
-  delay(1000);
+  // IMPORTANT! give the wifi thread the chance to write any pending data
+  waitForPendingTx();
 
   wifi_station_disconnect();
   wifi_set_opmode_current(NULL_MODE);
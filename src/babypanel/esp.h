@@ -1,5 +1,23 @@
 #pragma once
 
+/**
+ * Max time to wait for the wifi stack to send out pending TCP data before going to sleep
+ */
+constexpr unsigned int kLightSleepTxTimeoutMs = 1000;
+
+/**
+ * Time to let the wifi driver put any already sent UDP datagram (e.g., heartbeat) on the air
+ * before going to sleep - there's no acknowledgement to wait on for these
+ */
+constexpr unsigned int kLightSleepUdpSettleMs = 20;
+
+/**
+ * Block until any data handed to the wifi stack has been sent out
+ *
+ * Returns immediately if we are not connected to the WiFi, e.g., right after boot
+ */
+void waitForPendingTx();
+
 /**
  * Borrowed from https://efcomputer.net.au/blog/esp8266-light-sleep-mode/
  */
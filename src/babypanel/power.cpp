@@ -0,0 +1,119 @@
+#include <user_interface.h>
+
+#include "conf.h"
+#include "power.h"
+
+#include <ESP8266WiFi.h>
+
+// after conf.h and Arduino, for DEBUG and Serial
+#include "common.h"
+
+namespace
+{
+PowerPhase currentPhase = PowerPhase::Idle;
+
+/** RSSI of the last session, 0 if unknown (e.g., right after boot) */
+int32_t cachedRssi = 0;
+
+/**
+ * Extra TX power on top of what the RSSI calls for - the RSSI only tells how well we hear the
+ * access point, not how well it hears us, so it's stepped up every time a reduced TX power fails
+ * to associate and kept for all the following sessions
+ */
+float txPowerMarginDbm = 0;
+
+/** TX power applied at the start of the current session */
+float sessionTxPowerDbm = kMaxTxPowerDbm;
+
+uint8_t cpuFreqForPhase(PowerPhase phase)
+{
+  return phase == PowerPhase::Compute ? SYS_CPU_160MHZ : SYS_CPU_80MHZ;
+}
+
+bool modemSleepForPhase(PowerPhase phase)
+{
+  return phase == PowerPhase::Associating || phase == PowerPhase::AwaitingServer;
+}
+
+/**
+ * TX power that still leaves enough link margin for the given RSSI
+ */
+float txPowerForRssi(int32_t rssi)
+{
+  if (rssi == 0)
+  {
+    return kMaxTxPowerDbm;
+  }
+  if (rssi >= -50)
+  {
+    return 8.5;
+  }
+  if (rssi >= -60)
+  {
+    return 12.0;
+  }
+  if (rssi >= -70)
+  {
+    return 16.0;
+  }
+  return kMaxTxPowerDbm;
+}
+} // namespace
+
+PowerPhase setPowerPhase(PowerPhase phase)
+{
+  const PowerPhase previousPhase = currentPhase;
+  currentPhase = phase;
+
+  const uint8_t cpuFreq = cpuFreqForPhase(phase);
+  if (system_get_cpu_freq() != cpuFreq)
+  {
+    system_update_cpu_freq(cpuFreq);
+  }
+
+  // only touch the sleep mode while the radio is up, lightSleep() takes care of it otherwise
+  if (modemSleepForPhase(phase) && WiFi.getMode() != WIFI_OFF
+      && WiFi.getSleepMode() != WIFI_MODEM_SLEEP)
+  {
+    WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+  }
+
+  return previousPhase;
+}
+
+PowerPhase getPowerPhase() { return currentPhase; }
+
+ScopedPowerPhase::ScopedPowerPhase(PowerPhase phase) : m_previousPhase(setPowerPhase(phase)) {}
+ScopedPowerPhase::~ScopedPowerPhase() { setPowerPhase(m_previousPhase); }
+
+void applyCachedTxPower()
+{
+  sessionTxPowerDbm = min(txPowerForRssi(cachedRssi) + txPowerMarginDbm, kMaxTxPowerDbm);
+  DEBUG_PRINT("Setting TX power to ");
+  DEBUG_PRINT(sessionTxPowerDbm);
+  DEBUG_PRINT(" dBm | cached RSSI: ");
+  DEBUG_PRINT(cachedRssi);
+  DEBUG_PRINT(" | margin: ");
+  DEBUG_PRINTLN(txPowerMarginDbm);
+
+  WiFi.setOutputPower(sessionTxPowerDbm);
+}
+
+void boostTxPower()
+{
+  // the reduced TX power didn't make it, start the next sessions a step higher
+  if (sessionTxPowerDbm < kMaxTxPowerDbm)
+  {
+    txPowerMarginDbm += kTxPowerFailureStepDbm;
+  }
+
+  sessionTxPowerDbm = kMaxTxPowerDbm;
+  WiFi.setOutputPower(kMaxTxPowerDbm);
+}
+
+void cacheSessionRssi()
+{
+  // RSSI() reports 31 when it has no valid reading
+  const int32_t rssi = WiFi.RSSI();
+  cachedRssi = (WiFi.status() == WL_CONNECTED && rssi < 0) ? rssi : 0;
+}
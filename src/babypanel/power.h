@@ -0,0 +1,81 @@
+/**
+ * Power governor - adjusts the CPU clock, the modem sleep and the WiFi TX power to the phase of the
+ * press lifecycle we are in
+ */
+#pragma once
+
+#include <Arduino.h>
+
+// power phases ------------------------------------------------------------------------------------
+/**
+ * Phases of the press lifecycle, as far as power consumption is concerned
+ */
+enum class PowerPhase
+{
+  /** Awake, polling the buttons - 80 MHz */
+  Idle = 0,
+  /** Waiting on the access point to associate - 80 MHz, modem sleep */
+  Associating,
+  /** Waiting on a response of the server - 80 MHz, modem sleep */
+  AwaitingServer,
+  /** CPU-heavy work, e.g., JSON parsing - 160 MHz */
+  Compute
+};
+
+/**
+ * Switch to the given power phase
+ *
+ * @param phase The phase to switch to
+ * @return The phase we were in before the switch
+ */
+PowerPhase setPowerPhase(PowerPhase phase);
+
+/**
+ * Get the power phase we are currently in
+ */
+PowerPhase getPowerPhase();
+
+/**
+ * Switch to the given power phase for the lifetime of the object, then restore the previous one
+ */
+class ScopedPowerPhase
+{
+public:
+  explicit ScopedPowerPhase(PowerPhase phase);
+  ~ScopedPowerPhase();
+
+  ScopedPowerPhase(const ScopedPowerPhase&) = delete;
+  ScopedPowerPhase& operator=(const ScopedPowerPhase&) = delete;
+
+private:
+  PowerPhase m_previousPhase;
+};
+
+// TX power ----------------------------------------------------------------------------------------
+/**
+ * Max WiFi TX power the ESP8266 supports, used when we don't know any better
+ */
+constexpr float kMaxTxPowerDbm = 20.5;
+
+/**
+ * TX power added to the following sessions every time associating with a reduced TX power fails
+ */
+constexpr float kTxPowerFailureStepDbm = 4.0;
+
+/**
+ * Set the WiFi TX power based on the RSSI cached from the last session, i.e., transmit at lower
+ * power when the access point was heard loud and clear, plus the margin learnt from the sessions
+ * where that wasn't enough. Call before connecting to the WiFi.
+ */
+void applyCachedTxPower();
+
+/**
+ * Transmit at max power, e.g., when associating with the reduced TX power fails - also steps up the
+ * TX power of all the following sessions by kTxPowerFailureStepDbm
+ */
+void boostTxPower();
+
+/**
+ * Cache the RSSI of the current session, to set the TX power of the next one
+ */
+void cacheSessionRssi();
@@ -1,6 +1,8 @@
 #include "wifi.h"
+#include "boot.h"
 #include "common.h"
 #include "esp.h"
+#include "power.h"
 
 /**
  * Statically initialized WiFiClient instance to use across the application
@@ -8,18 +10,26 @@
 BBBDClient kBBBDClient = BBBDClient();
 
 // clang-format off
-const String kBabybuddyRequestHeaderPreamble =
-                 String("Host: ") + BABYBUDDY_SERVER_URL + "\n" +
-                 "Accept-Encoding: gzip, deflate, br\n" +
-                 "Connection: keep-alive\n" +
-                 "User-Agent: " + UserAgent + "\n" +
-                 "Accept: application/json, */*;q=0.5\n" +
-                 "Content-Type: application/json\n" +
-                 "Authorization: Token " + BABYBUDDY_TOKEN;
+const char* kBabybuddyRequestHeaderPreamble =
+                 "Host: " BABYBUDDY_SERVER_URL "\n"
+                 "Accept-Encoding: gzip, deflate, br\n"
+                 "Connection: keep-alive\n"
+                 "User-Agent: " BABYPANEL_USER_AGENT "\n"
+                 "Accept: application/json, */*;q=0.5\n"
+                 "Content-Type: application/json\n"
+                 "Authorization: Token " BABYBUDDY_TOKEN;
 // clang-format on
 
-const String kBabyBuddyChildIdJson = String("{\"child\": ") + STR(BABYBUDDY_CHILD_ID) + "}";
-const String kBabyBuddyTagJson = String("\"tags\":\"[\\\"") + UserAgent + +"\\\"]\"";
+String newEventId()
+{
+  // the chip id tells the boards apart, the hardware RNG the events of the same board
+  return String("evt-") + String(ESP.getChipId(), HEX) + "-" + String(ESP.random(), HEX);
+}
+
+String eventTagsJson(const String& eventId)
+{
+  return String(kBabyBuddyTagJsonPrefix) + ",\\\"" + eventId + "\\\"]\"";
+}
 
 const char* HttpMethodStrs[] = {"GET", "POST", "PUT", "DELETE"};
 
@@ -33,6 +43,9 @@ void connectToWifi(const int totalAttempts)
   const auto wifiSSID = WIFI_SSID;
   const auto wifiPassword = WIFI_PASSWORD;
 
+  applyCachedTxPower();
+  ScopedPowerPhase powerPhase(PowerPhase::Associating);
+
   WiFi.begin(wifiSSID, wifiPassword);
   delay(500);
 
@@ -42,6 +55,13 @@ void connectToWifi(const int totalAttempts)
   {
     delay(5000);
 
+    // the first attempt failed at the reduced TX power - don't let a stale RSSI cost us the
+    // connection
+    if (currAttempt == 0 && WiFi.status() != WL_CONNECTED)
+    {
+      boostTxPower();
+    }
+
     DEBUG_PRINT(" - Connecting to WiFi ");
     DEBUG_PRINT(wifiSSID);
     DEBUG_PRINT(", attempt #");
@@ -56,6 +76,8 @@ void connectToWifi(const int totalAttempts)
   DEBUG_PRINT(wifiSSID);
   DEBUG_PRINT(" | IP address: ");
   DEBUG_PRINTLN(WiFi.localIP());
+
+  cacheSessionRssi();
 }
 
 Response::Response(const char* headers, const char* body) : headers(headers), body(body) {}
@@ -64,7 +86,9 @@ Response::Response() {}
 size_t Response::printTo(Print& p) const
 {
   size_t size = 0;
-  size += p.print("Headers: \n");
+  size += p.print("Status: ");
+  size += p.print(status);
+  size += p.print("\nHeaders: \n");
   size += p.print(headers);
   size += p.print("\nBody: \n");
   size += p.print(body);
@@ -83,6 +107,7 @@ bool BBBDClient::connect()
     return false;
   }
 
+  m_responseUnread = false;
   return true;
 }
 
@@ -91,59 +116,304 @@ Response BBBDClient::makeRequest(HTTPMethod method, const char* url, const Strin
 {
   // request -------------------------------------------------------------------------------------
   String methodStr = String(HTTPMethodStr(method));
-  const int bodyLen = jsonBody->length();
   DEBUG_PRINT("Making HTTP request, method: ");
   DEBUG_PRINT(methodStr);
   DEBUG_PRINT(" | url: ");
   DEBUG_PRINTLN(url);
 
-  this->println(methodStr + " " + url + " HTTP/1.1\n" + kBabybuddyRequestHeaderPreamble + "\n"
-                + "Content-Length: " + bodyLen + "\n\n" + *jsonBody);
+  if (jsonBody != nullptr)
+  {
+    this->println(methodStr + " " + url + " HTTP/1.1\n" + kBabybuddyRequestHeaderPreamble + "\n"
+                  + "Content-Length: " + jsonBody->length() + "\n\n" + *jsonBody);
+  }
+  else
+  {
+    this->println(methodStr + " " + url + " HTTP/1.1\n" + kBabybuddyRequestHeaderPreamble + "\n");
+  }
 
+  bootProfileMarkFirstTx();
   DEBUG_PRINTLN("HTTP Request sent");
 
   Response response;
   String headers;
 
+  // the rest is just waiting on the server
+  ScopedPowerPhase powerPhase(PowerPhase::AwaitingServer);
+
   // response ------------------------------------------------------------------------------------
+  // the status line, e.g., "HTTP/1.1 201 Created"
+  String line = readStringUntil('\n');
+  if (line.startsWith("HTTP/"))
+  {
+    response.status = line.substring(line.indexOf(' ') + 1).toInt();
+  }
+
 #ifndef HTTP_ALWAYS_WAIT_FOR_RESPONSE_OVERRIDE
   if (!waitForResponse)
   {
-    DEBUG_PRINTLN("Returning immediately, won't wait for response");
-
-    // aparently I have to read at least a bit from the response for the POST request to go
-    // through and have an effect ?!
-    readStringUntil('\n');
+    DEBUG_PRINT("Returning after the status line, won't wait for the rest | status: ");
+    DEBUG_PRINTLN(response.status);
 
+    // the rest of the response is still in the socket, the connection can't be reused as is
+    m_responseUnread = true;
     return response;
   }
 #endif
 
-  String line;
-  while (line != "\r")
+  // headers, until the empty line
+  bool complete = line.length() != 0;
+  int contentLength = -1;
+  headers += line;
+  while (complete && line != "\r")
   {
     line = readStringUntil('\n');
+
+    // timed out - don't spin forever on a connection that went away
+    if (line.length() == 0)
+    {
+      DEBUG_PRINTLN("Timed out waiting for the response headers");
+      complete = false;
+      break;
+    }
     headers += line;
+
+    String headerLine = line;
+    headerLine.toLowerCase();
+    if (headerLine.startsWith("content-length:"))
+    {
+      contentLength = headerLine.substring(15).toInt();
+    }
   }
   response.headers = std::move(headers);
-  response.body = std::move(readStringUntil('\n'));
+
+  // body - the JSON bodies of Baby Buddy aren't terminated by a line ending, so read exactly
+  // Content-Length bytes of it instead of waiting for one to time out
+  if (complete && contentLength >= 0)
+  {
+    response.body.reserve(contentLength);
+    char buf[64];
+    while (static_cast<int>(response.body.length()) < contentLength)
+    {
+      const size_t toRead
+          = std::min(sizeof(buf), static_cast<size_t>(contentLength - response.body.length()));
+      const size_t numRead = readBytes(buf, toRead);
+      if (numRead == 0)
+      {
+        DEBUG_PRINTLN("Timed out waiting for the response body");
+        complete = false;
+        break;
+      }
+      response.body.concat(buf, numRead);
+    }
+  }
+  else if (complete)
+  {
+    // no Content-Length to go by, read what we can but don't trust what's left on the connection
+    response.body = readStringUntil('\n');
+    complete = false;
+  }
+
+  // whatever we didn't get to read is still in the socket, the connection can't be reused as is
+  m_responseUnread = !complete;
   announce("HTTP Response", response);
 
   return response;
 }
 
-int BBBDClient::createTimer()
+bool BBBDClient::prepareAttempt(int attempt)
+{
+  if (attempt > 0)
+  {
+    delay(kEventRetryBackoffMs * attempt);
+  }
+
+  // reuse the connection of the press if there's one and nothing is left unread on it, we can't
+  // trust it after a failed attempt
+  return (attempt == 0 && connected() && !m_responseUnread) || connect();
+}
+
+int BBBDClient::requestTimer()
 {
   String url = "/api/timers/";
-  const auto response = makeRequest(HTTPMethod::POST, url.c_str(), &kBabyBuddyChildIdJson, true);
+  const String body = kBabyBuddyChildIdJson;
+  const auto response = makeRequest(HTTPMethod::POST, url.c_str(), &body, true);
+  if (response.status < 200 || response.status >= 300)
+  {
+    return 0;
+  }
 
   // parse the response to get the timer id
+  ScopedPowerPhase powerPhase(PowerPhase::Compute);
   JsonDocument doc;
-  deserializeJson(doc, response.body);
+  if (deserializeJson(doc, response.body) || !doc["id"].is<int>())
+  {
+    return 0;
+  }
 
   return doc["id"];
 }
 
+int BBBDClient::createTimer()
+{
+  setTimeout(kEventResponseTimeoutMs);
+
+  int timerId = 0;
+  for (int attempt = 0; attempt < kEventDeliveryAttempts && timerId == 0; attempt++)
+  {
+    if (prepareAttempt(attempt))
+    {
+      timerId = requestTimer();
+    }
+  }
+
+  setTimeout(kDefaultStreamTimeoutMs);
+  return timerId;
+}
+
+int BBBDClient::countEvents(const char* url, const String& eventId)
+{
+  const String query = String(url) + "?tags=" + eventId + "&limit=1";
+  const auto response = makeRequest(HTTPMethod::GET, query.c_str(), nullptr, true);
+
+  // Baby Buddy validates the tags filter against the existing tags, so a tag that was never
+  // created, i.e., an event that never made it to the server, is rejected with a 400
+  if (response.status >= 400 && response.status < 500 && response.status != 408
+      && response.status != 429)
+  {
+    return 0;
+  }
+  if (response.status != 200)
+  {
+    return -1;
+  }
+
+  ScopedPowerPhase powerPhase(PowerPhase::Compute);
+  JsonDocument doc;
+  if (deserializeJson(doc, response.body) || !doc["count"].is<int>())
+  {
+    return -1;
+  }
+
+  return doc["count"];
+}
+
+bool BBBDClient::deliverEvent(PendingEvent& event)
+{
+  DEBUG_PRINT("Delivering event ");
+  DEBUG_PRINTLN(event.eventId);
+
+  for (int attempt = 0; attempt < kEventDeliveryAttempts; attempt++)
+  {
+    if (!prepareAttempt(attempt))
+    {
+      continue;
+    }
+
+    // a previous POST may have made it to the server even though we never heard back from it - if
+    // we can't tell, don't risk a duplicate and try again
+    if (event.maybeDelivered)
+    {
+      const int count = countEvents(event.url, event.eventId);
+      if (count > 0)
+      {
+        DEBUG_PRINTLN("Event already recorded by the server");
+        return true;
+      }
+      if (count < 0)
+      {
+        continue;
+      }
+    }
+
+    // the timer is only created once - an unused one is still valid on the next attempt, and a
+    // used one means the event is recorded, which the lookup above tells us
+    if (event.needsTimer && event.timerId == 0)
+    {
+      event.timerId = requestTimer();
+      if (event.timerId == 0)
+      {
+        continue;
+      }
+    }
+
+    // don't read a stale response as the one of the POST
+    if (m_responseUnread && !connect())
+    {
+      continue;
+    }
+
+    const String body = event.needsTimer ? String("{\"timer\":\"") + event.timerId + "\","
+                                               + event.body.substring(1)
+                                         : event.body;
+    event.maybeDelivered = true;
+    const auto response = makeRequest(HTTPMethod::POST, event.url, &body);
+    if (response.status >= 200 && response.status < 300)
+    {
+      return true;
+    }
+
+    // the server will keep rejecting it, no point in retrying
+    if (response.status >= 400 && response.status < 500 && response.status != 408
+        && response.status != 429)
+    {
+      DEBUG_PRINT("Event rejected by the server, dropping it | status: ");
+      DEBUG_PRINTLN(response.status);
+      return true;
+    }
+  }
+
+  DEBUG_PRINTLN("Failed to deliver event, keeping it for later");
+  return false;
+}
+
+bool BBBDClient::postEvent(const char* url, const String& body, const String& eventId,
+                           bool needsTimer)
+{
+  if (m_numPendingEvents == kMaxPendingEvents)
+  {
+    DEBUG_PRINT("Too many pending events, dropping ");
+    DEBUG_PRINTLN(m_pendingEvents[0].eventId);
+
+    for (int i = 1; i < m_numPendingEvents; i++)
+    {
+      m_pendingEvents[i - 1] = std::move(m_pendingEvents[i]);
+    }
+    m_numPendingEvents -= 1;
+  }
+
+  m_pendingEvents[m_numPendingEvents++] = PendingEvent{url, body, eventId, false, needsTimer, 0};
+  return deliverPendingEvents();
+}
+
+bool BBBDClient::deliverPendingEvents()
+{
+  setTimeout(kEventResponseTimeoutMs);
+
+  // deliver in order, and once one of them fails without even a connection to the server don't
+  // bother with the rest - the link is down. An event that failed on a live connection, e.g.,
+  // because its timer never came back, doesn't hold back the ones after it
+  int numKept = 0;
+  bool linkDown = false;
+  for (int i = 0; i < m_numPendingEvents; i++)
+  {
+    if (!linkDown && deliverEvent(m_pendingEvents[i]))
+    {
+      continue;
+    }
+    linkDown = linkDown || !connected();
+
+    if (numKept != i)
+    {
+      m_pendingEvents[numKept] = std::move(m_pendingEvents[i]);
+    }
+    numKept += 1;
+  }
+  m_numPendingEvents = numKept;
+
+  setTimeout(kDefaultStreamTimeoutMs);
+  return m_numPendingEvents == 0;
+}
+
 void BBBDClient::decideSendHeartbeat()
 {
   if (millis() - lastMillis > HEARTBEAT_PERIOD_S * 1000)
@@ -188,11 +458,20 @@ void BBBDClient::sendHeartbeat()
       return;
     }
   }
+
+  bootProfileMarkFirstTx();
 }
 
 void BBBDClient::connectAndSendHeartbeat()
 {
   connectToWifi();
   sendHeartbeat();
+
+  // piggyback on the wakeup to retry the events the server hasn't confirmed yet
+  if (m_numPendingEvents > 0)
+  {
+    deliverPendingEvents();
+  }
+
   lightSleep();
 }
@@ -8,9 +8,14 @@
 
 // supplementary methods and classes ---------------------------------------------------------------
 
-constexpr const char* UserAgent = "BabyBuddyArcadePanel/0.1.0";
+#define BABYPANEL_USER_AGENT "BabyBuddyArcadePanel/0.1.0"
 
-extern const String kBabyBuddyTagJson;
+constexpr const char* UserAgent = BABYPANEL_USER_AGENT;
+
+// plain string literals rather than Strings, so that they don't need any heap allocations by static
+// initializers at boot
+constexpr const char* kBabyBuddyTagJsonPrefix = "\"tags\":\"[\\\"" BABYPANEL_USER_AGENT "\\\"";
+constexpr const char* kBabyBuddyChildIdJson = "{\"child\": " STR(BABYBUDDY_CHILD_ID) "}";
 
 /**
  * Connect to the WiFi network
@@ -22,6 +27,66 @@ extern const String kBabyBuddyTagJson;
  */
 void connectToWifi(const int totalAttempts = 3);
 
+// event related -----------------------------------------------------------------------------------
+/**
+ * Attempts to deliver an event before keeping it around for the next time we're awake
+ */
+constexpr int kEventDeliveryAttempts = 4;
+
+/**
+ * Backoff between delivery attempts, multiplied by the attempt number
+ */
+constexpr unsigned long kEventRetryBackoffMs = 250;
+
+/**
+ * Stream timeout while delivering events - retrying is safe, so we can afford to keep it short
+ */
+constexpr unsigned long kEventResponseTimeoutMs = 750;
+
+/**
+ * Stream timeout for everything else, i.e., the Stream default
+ */
+constexpr unsigned long kDefaultStreamTimeoutMs = 1000;
+
+/**
+ * Max number of undelivered events to keep around, the oldest one is dropped after that
+ *
+ * They are kept in RAM, so they survive light sleep but not a reset/brownout - the 512 bytes of
+ * RTC user memory wouldn't fit more than a couple of event bodies anyway
+ */
+constexpr int kMaxPendingEvents = 8;
+
+/**
+ * Generate a new client event id, unique across boots and boards
+ */
+String newEventId();
+
+/**
+ * Get the "tags" JSON field carrying the user agent and the given client event id
+ *
+ * @param eventId The client event id, see newEventId()
+ */
+String eventTagsJson(const String& eventId);
+
+/**
+ * An event that hasn't been confirmed by the server yet
+ */
+struct PendingEvent
+{
+  const char* url;
+  String body;
+  String eventId;
+
+  /** whether a POST of the event was ever sent, i.e., whether the server may already have it */
+  bool maybeDelivered;
+
+  /** whether the event consumes a timer, created on its delivery and prepended to the body */
+  bool needsTimer;
+
+  /** the timer created for the event, 0 if none yet */
+  int timerId;
+};
+
 // HTTP method related -----------------------------------------------------------------------------
 /**
  * Enum class to represent the HTTP methods
@@ -58,6 +123,8 @@ public:
 
   size_t printTo(Print& p) const override;
 
+  /** HTTP status code, 0 if we didn't get a valid status line */
+  int status = 0;
   String headers;
   String body;
 };
@@ -74,10 +141,74 @@ public:
   bool connect();
   Response makeRequest(HTTPMethod method, const char* url, const String* jsonBody = nullptr,
                        bool waitForResponse = false);
+
+  /**
+   * Create a timer, retrying up to kEventDeliveryAttempts times
+   *
+   * @return The id of the timer, 0 if we couldn't create one
+   */
   int createTimer();
   void decideSendHeartbeat();
 
+  /**
+   * Deliver an event exactly once
+   *
+   * The event is kept around (in RAM, see kMaxPendingEvents) until the server confirms it, and is
+   * retried along with every new event (or heartbeat) until then. Before posting it again, the
+   * server is checked for an existing record carrying its client event id, so retries never
+   * create duplicate entries.
+   *
+   * @param url The API endpoint to POST the event to
+   * @param body The JSON body of the event, carrying the eventTagsJson() of the eventId
+   * @param eventId The client event id, see newEventId()
+   * @param needsTimer Whether the event consumes a timer - it's created along with the delivery
+   *        and its "timer" field prepended to body, so a failed timer creation is retried like
+   *        any other part of the delivery instead of posting an invalid timer
+   * @return Whether this and every event pending before it are now settled
+   */
+  bool postEvent(const char* url, const String& body, const String& eventId,
+                 bool needsTimer = false);
+
+  /**
+   * Retry delivering the events that the server hasn't confirmed yet
+   *
+   * @return Whether there are no pending events left
+   */
+  bool deliverPendingEvents();
+
 private:
+  /**
+   * Back off before a retry and make sure there's a connection we can trust
+   *
+   * @param attempt The attempt number, starting at 0
+   * @return Whether we are connected
+   */
+  bool prepareAttempt(int attempt);
+
+  /**
+   * Create a timer in a single request
+   *
+   * @return The id of the timer, 0 if we couldn't create one
+   */
+  int requestTimer();
+
+  /**
+   * Try delivering an event up to kEventDeliveryAttempts times
+   *
+   * @return Whether the event is settled, i.e., the server confirmed it or rejected it for good
+   */
+  bool deliverEvent(PendingEvent& event);
+
+  /**
+   * Count the records at url that carry the given client event id
+   *
+   * A client error of the lookup itself counts as no records, since that's how Baby Buddy answers
+   * for a tag it has never seen
+   *
+   * @return The number of records, -1 if we couldn't tell
+   */
+  int countEvents(const char* url, const String& eventId);
+
   /**
    * Send a heartbeat by sending an empty UDP packet to the
    * HEARTBEAT_SERVER_ADDR:HEARTBEAT_SERVER_PORT
@@ -86,6 +217,12 @@ private:
   void connectAndSendHeartbeat();
 
   int lastMillis = 0;
+
+  /** whether the response of the last request was left (partly) unread in the socket */
+  bool m_responseUnread = false;
+
+  PendingEvent m_pendingEvents[kMaxPendingEvents];
+  int m_numPendingEvents = 0;
 };
 
 /**